@@ -0,0 +1,344 @@
+/*
+ *	A self-balancing (AVL) variant of Tree.
+ *
+ *	Nodes live in a single slice and refer to each other by int32 index
+ *	instead of by pointer, so the whole tree is one allocation for the GC
+ *	to trace and neighbouring nodes tend to share cache lines. Index 0 is
+ *	a sentinel standing in for nil, with height 0. The zero value is an
+ *	empty tree ready to use.
+ *
+ *	Find, Insert and Delete walk the tree with loops instead of recursion;
+ *	Insert and Delete remember the path they took in a fixed size array
+ *	and retrace it bottom up to restore balance. An AVL tree of n nodes is
+ *	at most 1.44 * log2(n) high, so maxHeight covers any int32 index.
+ */
+
+package main
+
+import (
+	"errors"
+)
+
+const (
+	nilNode   int32 = 0
+	maxHeight       = 48
+)
+
+type avlNode struct {
+	Value  string
+	Data   string
+	Left   int32
+	Right  int32
+	Height int32
+}
+
+type AVLTree struct {
+	nodes    []avlNode
+	root     int32
+	freeList int32 // deleted nodes, chained through Left
+	size     int
+}
+
+/*
+ *	NewAVLTree returns an empty tree with room for capacity nodes before
+ *	the arena has to grow
+ */
+func NewAVLTree(capacity int) *AVLTree {
+	return &AVLTree{nodes: make([]avlNode, 1, capacity+1)}
+}
+
+/*	Len returns the number of values in the tree */
+func (t *AVLTree) Len() int {
+	return t.size
+}
+
+func (t *AVLTree) height(n int32) int32 {
+	return t.nodes[n].Height
+}
+
+func (t *AVLTree) fixHeight(n int32) {
+	node := &t.nodes[n]
+	l, r := t.nodes[node.Left].Height, t.nodes[node.Right].Height
+	if l > r {
+		node.Height = l + 1
+	} else {
+		node.Height = r + 1
+	}
+}
+
+/*
+ *	rotateRight lifts the left child of n into its place and returns it,
+ *	rotateLeft does the mirror image
+ */
+func (t *AVLTree) rotateRight(n int32) int32 {
+	l := t.nodes[n].Left
+	t.nodes[n].Left = t.nodes[l].Right
+	t.nodes[l].Right = n
+	t.fixHeight(n)
+	t.fixHeight(l)
+	return l
+}
+
+func (t *AVLTree) rotateLeft(n int32) int32 {
+	r := t.nodes[n].Right
+	t.nodes[n].Right = t.nodes[r].Left
+	t.nodes[r].Left = n
+	t.fixHeight(n)
+	t.fixHeight(r)
+	return r
+}
+
+/*
+ *	balance restores the AVL property at n, whose subtrees differ in
+ *	height by at most two, and returns the new root of the subtree
+ */
+func (t *AVLTree) balance(n int32) int32 {
+	t.fixHeight(n)
+	node := &t.nodes[n]
+	diff := t.height(node.Left) - t.height(node.Right)
+
+	switch {
+	case diff > 1:
+		l := node.Left
+		if t.height(t.nodes[l].Left) < t.height(t.nodes[l].Right) {
+			t.nodes[n].Left = t.rotateLeft(l)
+		}
+		return t.rotateRight(n)
+	case diff < -1:
+		r := node.Right
+		if t.height(t.nodes[r].Right) < t.height(t.nodes[r].Left) {
+			t.nodes[n].Right = t.rotateRight(r)
+		}
+		return t.rotateLeft(n)
+	}
+	return n
+}
+
+/*
+ *	retrace rebalances the nodes on path from the bottom up and links each
+ *	rebalanced subtree back into its parent. Once a subtree comes out as
+ *	high as it was before, nothing above it can have changed.
+ */
+func (t *AVLTree) retrace(path []int32) {
+	for i := len(path) - 1; i >= 0; i-- {
+		old := path[i]
+		oldHeight := t.nodes[old].Height
+		n := t.balance(old)
+		if n != old {
+			if i == 0 {
+				t.root = n
+			} else if parent := &t.nodes[path[i-1]]; parent.Left == old {
+				parent.Left = n
+			} else {
+				parent.Right = n
+			}
+		}
+		if t.nodes[n].Height == oldHeight {
+			return
+		}
+	}
+}
+
+func (t *AVLTree) newNode(value, data string) int32 {
+	if len(t.nodes) == 0 {
+		t.nodes = append(t.nodes, avlNode{})
+	}
+
+	n := avlNode{Value: value, Data: data, Height: 1}
+	if t.freeList != nilNode {
+		i := t.freeList
+		t.freeList = t.nodes[i].Left
+		t.nodes[i] = n
+		return i
+	}
+	t.nodes = append(t.nodes, n)
+	return int32(len(t.nodes) - 1)
+}
+
+/*
+ *	Find searches for a string
+ *	Return Values:
+ *		The data associated with the value and true if found
+ *		"" and false if not found
+ */
+func (t *AVLTree) Find(s string) (string, bool) {
+	n := t.root
+	for n != nilNode {
+		node := &t.nodes[n]
+		switch {
+		case s == node.Value:
+			return node.Data, true
+		case s < node.Value:
+			n = node.Left
+		default:
+			n = node.Right
+		}
+	}
+	return "", false
+}
+
+/*
+ *	Insert a new value into the tree, inserting a value that is already
+ *	present leaves the tree unchanged just like Tree.Insert
+ *
+ *	Pseudocode
+ *		1. Walk down from the root like Find, remembering the path
+ *		2. If the value is found, return
+ *		3. Hang a new leaf off the last node on the path
+ *		4. Retrace the path bottom up, rebalancing every node on it
+ */
+func (t *AVLTree) Insert(value, data string) error {
+	var pathBuf [maxHeight]int32
+	path := pathBuf[:0]
+
+	n := t.root
+	for n != nilNode {
+		path = append(path, n)
+		node := &t.nodes[n]
+		switch {
+		case value == node.Value:
+			return nil
+		case value < node.Value:
+			n = node.Left
+		default:
+			n = node.Right
+		}
+	}
+
+	// deleted slots can still be reused once the arena hits the int32 limit
+	if t.freeList == nilNode && len(t.nodes) >= 1<<31-1 {
+		return errors.New("AVLTree is full")
+	}
+
+	leaf := t.newNode(value, data)
+	t.size++
+	if len(path) == 0 {
+		t.root = leaf
+		return nil
+	}
+
+	parent := &t.nodes[path[len(path)-1]]
+	if value < parent.Value {
+		parent.Left = leaf
+	} else {
+		parent.Right = leaf
+	}
+	t.retrace(path)
+	return nil
+}
+
+/*
+ * 	Delete removes an element from the tree. It is an error to
+ *	try deleting an element that does not exist.
+ *	Pseudocode:
+ *		1. Walk down to the node to be deleted, remembering the path
+ *		2. If the node has two children, keep walking down to the
+ *			maximum of its left subtree, move that value & data into
+ *			the node and delete the maximum node instead
+ *		3. The node now has at most one child, replace it with that child
+ *		4. Retrace the path bottom up, rebalancing every node on it
+ */
+func (t *AVLTree) Delete(s string) error {
+	var pathBuf [maxHeight]int32
+	path := pathBuf[:0]
+
+	n := t.root
+	for n != nilNode && s != t.nodes[n].Value {
+		path = append(path, n)
+		if s < t.nodes[n].Value {
+			n = t.nodes[n].Left
+		} else {
+			n = t.nodes[n].Right
+		}
+	}
+	if n == nilNode {
+		return errors.New("Value to be deleted does not exist in the tree")
+	}
+
+	victim := n
+	if t.nodes[n].Left != nilNode && t.nodes[n].Right != nilNode {
+		path = append(path, n)
+		victim = t.nodes[n].Left
+		for t.nodes[victim].Right != nilNode {
+			path = append(path, victim)
+			victim = t.nodes[victim].Right
+		}
+		t.nodes[n].Value = t.nodes[victim].Value
+		t.nodes[n].Data = t.nodes[victim].Data
+	}
+
+	child := t.nodes[victim].Left
+	if child == nilNode {
+		child = t.nodes[victim].Right
+	}
+
+	if len(path) == 0 {
+		t.root = child
+	} else if parent := &t.nodes[path[len(path)-1]]; parent.Left == victim {
+		parent.Left = child
+	} else {
+		parent.Right = child
+	}
+
+	// clear the strings so the GC can collect them, then recycle the slot
+	t.nodes[victim] = avlNode{Left: t.freeList}
+	t.freeList = victim
+	t.size--
+
+	t.retrace(path)
+	return nil
+}
+
+/* --------------- In Order Iterator --------------- */
+
+/*
+ *	AVLIterator walks the tree in order without recursion or callbacks,
+ *	replacing Traverse:
+ *
+ *		for it := t.Iter(); it.Next(); {
+ *			fmt.Print(it.Value(), ": ", it.Data())
+ *		}
+ *
+ *	The tree must not be modified while it is being iterated.
+ */
+type AVLIterator struct {
+	t     *AVLTree
+	stack [maxHeight]int32
+	depth int
+	cur   int32
+}
+
+/*	Iter returns an iterator positioned before the smallest value */
+func (t *AVLTree) Iter() AVLIterator {
+	it := AVLIterator{t: t}
+	it.pushLeft(t.root)
+	return it
+}
+
+func (it *AVLIterator) pushLeft(n int32) {
+	for n != nilNode {
+		it.stack[it.depth] = n
+		it.depth++
+		n = it.t.nodes[n].Left
+	}
+}
+
+/*	Next advances to the next value and reports whether there was one */
+func (it *AVLIterator) Next() bool {
+	if it.depth == 0 {
+		it.cur = nilNode
+		return false
+	}
+	it.depth--
+	it.cur = it.stack[it.depth]
+	it.pushLeft(it.t.nodes[it.cur].Right)
+	return true
+}
+
+func (it *AVLIterator) Value() string {
+	return it.t.nodes[it.cur].Value
+}
+
+func (it *AVLIterator) Data() string {
+	return it.t.nodes[it.cur].Data
+}
@@ -265,5 +265,23 @@ func main() {
 	fmt.Print("After deleting '" + s + "': ")
 	tree.Traverse(tree.Root, func(n *Node) { fmt.Print(n.Value, ": ", n.Data, " | ") })
 	fmt.Println()
+
+	// The same again with the balanced tree, walked with an iterator.
+	avl := &AVLTree{}
+	for i := 0; i < len(values); i++ {
+		err := avl.Insert(values[i], data[i])
+		if err != nil {
+			log.Fatal("Error inserting value '", values[i], "' into AVLTree: ", err)
+		}
+	}
+	err = avl.Delete(s)
+	if err != nil {
+		log.Fatal("Error deleting "+s+" from AVLTree: ", err)
+	}
+	fmt.Print("AVLTree after deleting '" + s + "': | ")
+	for it := avl.Iter(); it.Next(); {
+		fmt.Print(it.Value(), ": ", it.Data(), " | ")
+	}
+	fmt.Println()
 }
 
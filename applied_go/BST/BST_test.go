@@ -0,0 +1,177 @@
+/*
+ *	Checks AVLTree against a map, and benchmarks it against the
+ *	unbalanced Tree on sorted and random keys.
+ *
+ *	go test -bench . -benchmem BST.go AVLTree.go BST_test.go
+ */
+
+package main
+
+import (
+	"fmt"
+	"math/rand"
+	"sort"
+	"testing"
+)
+
+const benchKeys = 4096
+
+func sortedKeys(n int) []string {
+	keys := make([]string, n)
+	for i := range keys {
+		keys[i] = fmt.Sprintf("key%08d", i)
+	}
+	return keys
+}
+
+func randomKeys(n int) []string {
+	keys := sortedKeys(n)
+	rand.New(rand.NewSource(1)).Shuffle(n, func(i, j int) {
+		keys[i], keys[j] = keys[j], keys[i]
+	})
+	return keys
+}
+
+func TestAVLTree(t *testing.T) {
+	rng := rand.New(rand.NewSource(2))
+	tree := &AVLTree{}
+	want := map[string]string{}
+
+	for i := 0; i < 20000; i++ {
+		k := fmt.Sprint(rng.Intn(2000))
+		if rng.Intn(3) == 0 {
+			_, ok := want[k]
+			if err := tree.Delete(k); (err == nil) != ok {
+				t.Fatalf("Delete(%q) = %v, present %v", k, err, ok)
+			}
+			delete(want, k)
+		} else {
+			if _, ok := want[k]; !ok {
+				want[k] = fmt.Sprint(i)
+			}
+			tree.Insert(k, fmt.Sprint(i))
+		}
+	}
+
+	if tree.Len() != len(want) {
+		t.Fatalf("Len() = %d, want %d", tree.Len(), len(want))
+	}
+	for k, v := range want {
+		if d, ok := tree.Find(k); !ok || d != v {
+			t.Fatalf("Find(%q) = %q, %v, want %q", k, d, ok, v)
+		}
+	}
+	if h, max := tree.height(tree.root), 1.45*float64(bitLen(len(want))); float64(h) > max {
+		t.Fatalf("height %d exceeds AVL bound %.0f", h, max)
+	}
+
+	keys := make([]string, 0, len(want))
+	for k := range want {
+		keys = append(keys, k)
+	}
+	sort.Strings(keys)
+	i := 0
+	for it := tree.Iter(); it.Next(); i++ {
+		if i >= len(keys) || it.Value() != keys[i] || it.Data() != want[keys[i]] {
+			t.Fatalf("iterator out of order at %d: %q", i, it.Value())
+		}
+	}
+	if i != len(keys) {
+		t.Fatalf("iterator returned %d values, want %d", i, len(keys))
+	}
+}
+
+func bitLen(n int) int {
+	b := 0
+	for ; n > 0; n >>= 1 {
+		b++
+	}
+	return b
+}
+
+/* --------------- Benchmarks --------------- */
+
+var keySets = []struct {
+	name string
+	keys []string
+}{
+	{"sorted", sortedKeys(benchKeys)},
+	{"random", randomKeys(benchKeys)},
+}
+
+/*	One op builds a tree out of all benchKeys keys */
+func BenchmarkInsert(b *testing.B) {
+	for _, ks := range keySets {
+		b.Run("Tree/"+ks.name, func(b *testing.B) {
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				tree := &Tree{}
+				for _, k := range ks.keys {
+					tree.Insert(k, k)
+				}
+			}
+		})
+		b.Run("AVLTree/"+ks.name, func(b *testing.B) {
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				tree := NewAVLTree(len(ks.keys))
+				for _, k := range ks.keys {
+					tree.Insert(k, k)
+				}
+			}
+		})
+	}
+}
+
+/*	One op is one lookup */
+func BenchmarkFind(b *testing.B) {
+	for _, ks := range keySets {
+		tree := &Tree{}
+		avl := NewAVLTree(len(ks.keys))
+		for _, k := range ks.keys {
+			tree.Insert(k, k)
+			avl.Insert(k, k)
+		}
+
+		b.Run("Tree/"+ks.name, func(b *testing.B) {
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				tree.Find(ks.keys[i%len(ks.keys)])
+			}
+		})
+		b.Run("AVLTree/"+ks.name, func(b *testing.B) {
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				avl.Find(ks.keys[i%len(ks.keys)])
+			}
+		})
+	}
+}
+
+/*	One op is a full in order walk */
+func BenchmarkTraverse(b *testing.B) {
+	keys := randomKeys(benchKeys)
+	tree := &Tree{}
+	avl := NewAVLTree(len(keys))
+	for _, k := range keys {
+		tree.Insert(k, k)
+		avl.Insert(k, k)
+	}
+
+	b.Run("Tree", func(b *testing.B) {
+		b.ReportAllocs()
+		n := 0
+		for i := 0; i < b.N; i++ {
+			tree.Traverse(tree.Root, func(*Node) { n++ })
+		}
+	})
+	b.Run("AVLTree", func(b *testing.B) {
+		b.ReportAllocs()
+		n := 0
+		for i := 0; i < b.N; i++ {
+			for it := avl.Iter(); it.Next(); {
+				n++
+			}
+		}
+	})
+}
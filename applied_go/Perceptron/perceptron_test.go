@@ -0,0 +1,235 @@
+/*
+ *	Checks the batch API against the per-point one, and benchmarks the
+ *	two against each other.
+ *
+ *	go test -bench . -benchmem
+ *
+ *	perceptron.go imports github.com/appliedgo/perceptron/draw, so that
+ *	package (or a stub of it providing NewCanvas, DrawPoint,
+ *	DrawLinearFunction and Save) must be on the module path to build.
+ */
+
+package main
+
+import (
+	"fmt"
+	"math"
+	"math/rand"
+	"testing"
+)
+
+/*
+ *	makeData returns rows random points of dim coordinates between -100
+ *	and 100, row-major, labelled by isAboveLine on their first two
+ */
+func makeData(rows, dim int, rng *rand.Rand) ([]int32, []int32) {
+	inputs := make([]int32, rows*dim)
+	labels := make([]int32, rows)
+	for r := 0; r < rows; r++ {
+		x := inputs[r*dim : (r+1)*dim]
+		for i := range x {
+			x[i] = rng.Int31n(201) - 101
+		}
+		labels[r] = isAboveLine(x, f)
+	}
+	return inputs, labels
+}
+
+/*
+ *	setLine sets the separation line; the benchmarks cannot assign b
+ *	themselves as their *testing.B parameter shadows it
+ */
+func setLine(slope, intercept int32) {
+	a, b = slope, intercept
+}
+
+func TestProcessBatch(t *testing.T) {
+	rng := rand.New(rand.NewSource(1))
+	for _, dim := range []int{2, 3, 17} {
+		// weights of 1/8ths keep every sum exact, whatever the order
+		p := NewPerceptron(int32(dim))
+		for i := range p.weights {
+			p.weights[i] = float32(rng.Intn(17)-8) / 8
+		}
+		p.bias = float32(rng.Intn(17)-8) / 8
+
+		inputs, _ := makeData(3*minRowsPerWorker+5, dim, rng)
+		out := make([]int32, len(inputs)/dim)
+		p.ProcessBatch(inputs, out, 4)
+		for r := range out {
+			if want := p.Process(inputs[r*dim : (r+1)*dim]); out[r] != want {
+				t.Fatalf("dim %d row %d: ProcessBatch %d, Process %d", dim, r, out[r], want)
+			}
+		}
+	}
+}
+
+/*	accuracy returns the fraction of rows p classifies as labelled */
+func accuracy(p *Perceptron, inputs, labels []int32) float64 {
+	out := make([]int32, len(labels))
+	p.ProcessBatch(inputs, out, 0)
+	correct := 0
+	for r := range out {
+		if out[r] == labels[r] {
+			correct++
+		}
+	}
+	return float64(correct) / float64(len(labels))
+}
+
+func TestTrainEpoch(t *testing.T) {
+	rng := rand.New(rand.NewSource(2))
+	setLine(2, 7)
+	inputs, labels := makeData(1<<14, 2, rng)
+
+	p := NewPerceptron(2)
+	trainer := NewBatchTrainer(p, 2, 3)
+	for epoch := 0; epoch < 50; epoch++ {
+		trainer.TrainEpoch(inputs, labels, 64, 0.1)
+	}
+
+	if acc := accuracy(p, inputs, labels); acc < 0.95 {
+		t.Fatalf("%.1f%% of points classified correctly after training", 100*acc)
+	}
+}
+
+/*
+ *	Minibatches big enough to split over workers run the goroutine fan-out
+ *	and the reduction of per-worker sums; a fixed seed and worker count
+ *	must still give the same weights every time.
+ */
+func TestTrainEpochParallel(t *testing.T) {
+	rng := rand.New(rand.NewSource(4))
+	setLine(-3, 20)
+	inputs, labels := makeData(1<<15, 2, rng)
+	batchSize := 2 * minRowsPerWorker
+	if splitRows(batchSize, 4) < 2 {
+		t.Fatalf("batch of %d rows does not use several workers", batchSize)
+	}
+
+	// one minibatch of the whole set: replay every worker's draws against
+	// the starting weights and check the update is the mean correction
+	p := &Perceptron{weights: []float32{0.5, -0.25}, bias: 0.125}
+	rows := 4 * minRowsPerWorker
+	NewBatchTrainer(p, 4, 5).TrainEpoch(inputs[:2*rows], labels[:rows], rows, 1)
+	start := &Perceptron{weights: []float32{0.5, -0.25}, bias: 0.125}
+	var sum [3]float64
+	for w := 0; w < 4; w++ {
+		wrng := rand.New(rand.NewSource(5 + int64(w)))
+		for i := 0; i < rows/4; i++ {
+			r := wrng.Intn(rows)
+			x := inputs[2*r : 2*r+2]
+			d := float64(labels[r] - start.Process(x))
+			sum[0] += float64(x[0]) * d
+			sum[1] += float64(x[1]) * d
+			sum[2] += d
+		}
+	}
+	want := []float64{0.5 + sum[0]/float64(rows), -0.25 + sum[1]/float64(rows), 0.125 + sum[2]/float64(rows)}
+	got := []float32{p.weights[0], p.weights[1], p.bias}
+	for i := range want {
+		if math.Abs(float64(got[i])-want[i]) > 1e-4 {
+			t.Fatalf("minibatch update %v, want %v", got, want)
+		}
+	}
+
+	var runs [2]*Perceptron
+	for i := range runs {
+		runs[i] = &Perceptron{weights: []float32{0.5, -0.25}, bias: 0.125}
+		trainer := NewBatchTrainer(runs[i], 4, 5)
+		for epoch := 0; epoch < 200; epoch++ {
+			trainer.TrainEpoch(inputs, labels, batchSize, 1)
+		}
+	}
+
+	if acc := accuracy(runs[0], inputs, labels); acc < 0.95 {
+		t.Fatalf("%.1f%% of points classified correctly after training", 100*acc)
+	}
+	for i := range runs[0].weights {
+		if runs[0].weights[i] != runs[1].weights[i] {
+			t.Fatalf("weights differ between runs: %v, %v", runs[0].weights, runs[1].weights)
+		}
+	}
+	if runs[0].bias != runs[1].bias {
+		t.Fatalf("bias differs between runs: %v, %v", runs[0].bias, runs[1].bias)
+	}
+}
+
+func TestEmptyBatch(t *testing.T) {
+	p := NewPerceptron(2)
+	NewBatchTrainer(p, 2, 1).TrainEpoch(nil, nil, 64, 0.1)
+	p.ProcessBatch(nil, nil, 0)
+	(&Perceptron{}).ProcessBatch([]int32{1, 2}, make([]int32, 2), 0)
+}
+
+/* --------------- Benchmarks --------------- */
+
+const benchRows = 1 << 16
+
+func reportSamples(b *testing.B, samples int) {
+	b.ReportMetric(float64(b.N)*float64(samples)/b.Elapsed().Seconds(), "samples/sec")
+}
+
+/*	One op scores benchRows points */
+func BenchmarkProcess(b *testing.B) {
+	setLine(2, 7)
+	for _, dim := range []int{2, 32} {
+		inputs, _ := makeData(benchRows, dim, rand.New(rand.NewSource(1)))
+		p := NewPerceptron(int32(dim))
+		out := make([]int32, benchRows)
+
+		b.Run(fmt.Sprintf("PerPoint/dim=%d", dim), func(b *testing.B) {
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				for r := 0; r < benchRows; r++ {
+					out[r] = p.Process(inputs[r*dim : (r+1)*dim])
+				}
+			}
+			reportSamples(b, benchRows)
+		})
+		b.Run(fmt.Sprintf("Batch/dim=%d", dim), func(b *testing.B) {
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				p.ProcessBatch(inputs, out, 0)
+			}
+			reportSamples(b, benchRows)
+		})
+	}
+}
+
+/*	One op trains on benchRows points */
+func BenchmarkTrain(b *testing.B) {
+	setLine(2, 7)
+	inputs, labels := makeData(benchRows, 2, rand.New(rand.NewSource(1)))
+
+	// train() as main uses it, drawing and allocating every point
+	b.Run("train", func(b *testing.B) {
+		b.ReportAllocs()
+		p := NewPerceptron(2)
+		for i := 0; i < b.N; i++ {
+			train(p, benchRows, 0.1)
+		}
+		reportSamples(b, benchRows)
+	})
+	b.Run("PerPoint", func(b *testing.B) {
+		b.ReportAllocs()
+		p := NewPerceptron(2)
+		for i := 0; i < b.N; i++ {
+			for r := 0; r < benchRows; r++ {
+				x := inputs[r*2 : (r+1)*2]
+				p.Adjust(x, labels[r]-p.Process(x), 0.1)
+			}
+		}
+		reportSamples(b, benchRows)
+	})
+	for _, batch := range []int{64, 8192} {
+		b.Run(fmt.Sprintf("TrainEpoch/batch=%d", batch), func(b *testing.B) {
+			b.ReportAllocs()
+			trainer := NewBatchTrainer(NewPerceptron(2), 0, 1)
+			for i := 0; i < b.N; i++ {
+				trainer.TrainEpoch(inputs, labels, batch, 0.1)
+			}
+			reportSamples(b, benchRows)
+		})
+	}
+}
@@ -0,0 +1,465 @@
+/*
+ * Native Shannon entropy scoring, see entropy.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "entropy.h"
+#include "format_double.h"
+
+/* c * log2(c) is looked up for counts below this and computed above it */
+#define XLOGX_TABLE_SIZE (4096)
+
+/* lines at least this long use the four way histogram */
+#define LONG_LINE (256)
+
+/* bytes of input handed to the threads at a time */
+#define BATCH_BYTES (16 << 20)
+
+/* room one output line needs: two doubles, a tab and a newline */
+#define MAX_OUT_LINE (2 * FORMAT_DOUBLE_MAX + 2)
+
+static double xlogx_table[XLOGX_TABLE_SIZE];
+static pthread_once_t xlogx_once = PTHREAD_ONCE_INIT;
+
+typedef struct scoreJob {
+    const unsigned char *start;     /* the first line of this job */
+    const unsigned char *end;       /* one past the last line */
+    char *out;                      /* the formatted scores */
+    size_t out_len;
+    size_t out_cap;
+    unsigned char *line;            /* a \r terminated line, as \n */
+    size_t line_cap;
+    long long lines;
+    int mode;                       /* one of ENTROPY_* */
+    int cr;                         /* the input holds a \r somewhere */
+    int threaded;                   /* scored on a thread of its own */
+    int failed;
+} scoreJob;
+
+static void InitXLogXTable(void)
+{
+    int c;
+
+    xlogx_table[0] = 0.0;
+    for (c = 1; c < XLOGX_TABLE_SIZE; c++) {
+        xlogx_table[c] = c * log2((double) c);
+    }
+}
+
+static inline double XLogX(uint32_t c)
+{
+    if (c < XLOGX_TABLE_SIZE) {
+        return xlogx_table[c];
+    }
+    return c * log2((double) c);
+}
+
+/*
+ * Entropy of one line. hist must be all zero on entry and is left all
+ * zero, so a caller scoring many lines clears it only once.
+ *
+ * Short lines count into a single histogram and then walk the line again
+ * to sum and clear just the bins they touched; bins already cleared add
+ * xlogx_table[0] == 0, which keeps the walk branchless. Long lines count
+ * into four histograms so consecutive equal bytes do not serialise on
+ * one counter, then fold the four together in a loop the compiler
+ * vectorises.
+ */
+static double LineEntropy(const unsigned char *s, size_t len,
+        uint32_t hist[4][256])
+{
+    double sum = 0.0, h;
+    uint32_t c;
+    size_t i;
+    int b;
+
+    if (len == 0) {
+        return 0.0;
+    }
+
+    if (len < LONG_LINE) {
+        for (i = 0; i < len; i++) {
+            hist[0][s[i]]++;
+        }
+        for (i = 0; i < len; i++) {
+            sum += xlogx_table[hist[0][s[i]]];
+            hist[0][s[i]] = 0;
+        }
+    } else {
+        for (i = 0; i + 4 <= len; i += 4) {
+            hist[0][s[i]]++;
+            hist[1][s[i + 1]]++;
+            hist[2][s[i + 2]]++;
+            hist[3][s[i + 3]]++;
+        }
+        for (; i < len; i++) {
+            hist[0][s[i]]++;
+        }
+        for (b = 0; b < 256; b++) {
+            hist[0][b] += hist[1][b] + hist[2][b] + hist[3][b];
+        }
+        memset(hist[1], 0, 3 * sizeof(hist[1]));
+        for (b = 0; b < 256; b++) {
+            c = hist[0][b];
+            sum += XLogX(c);
+        }
+        memset(hist[0], 0, sizeof(hist[0]));
+    }
+
+    h = log2((double) len) - sum / len;
+
+    /* a single distinct byte can land a rounding error below zero */
+    return (h > 0.0) ? h : 0.0;
+}
+
+/*
+ * Entropy of one line computed exactly the way entropy.py does, for
+ * output that matches it digit for digit: the bytes are visited in order
+ * of first occurrence, each adds p * log(p) / log(2.0) to a running sum,
+ * and the sum is negated, giving -0.0 for a single distinct byte.
+ *
+ * Up to python 3.11 sum() adds left to right. From 3.12 on it carries
+ * the rounding error of every addition in a second sum, Neumaier's
+ * variant of Kahan summation, and adds that in at the end; compensated
+ * selects this. Same contract on hist as LineEntropy.
+ */
+static double LineEntropyPython(const unsigned char *s, size_t len,
+        uint32_t hist[4][256], int compensated)
+{
+    double sum = 0.0, err = 0.0, p, x, t;
+    uint32_t c;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hist[0][s[i]]++;
+    }
+    for (i = 0; i < len; i++) {
+        c = hist[0][s[i]];
+        if (c) {
+            p = (double) c / (double) len;
+            x = p * log(p) / log(2.0);
+            t = sum + x;
+            if (fabs(sum) >= fabs(x)) {
+                err += (sum - t) + x;
+            } else {
+                err += (x - t) + sum;
+            }
+            sum = t;
+            hist[0][s[i]] = 0;
+        }
+    }
+    if (compensated && err != 0.0 && isfinite(err)) {
+        sum += err;
+    }
+    return -sum;
+}
+
+double Entropy(const unsigned char *s, size_t len, int compensated)
+{
+    uint32_t hist[4][256];
+
+    memset(hist, 0, sizeof(hist));
+    return LineEntropyPython(s, len, hist, compensated);
+}
+
+double EntropyIdeal(size_t len)
+{
+    double prob = 1.0 / (double) len;
+
+    return -1.0 * (double) len * prob * log(prob) / log(2.0);
+}
+
+double EntropyFast(const unsigned char *s, size_t len)
+{
+    uint32_t hist[4][256];
+
+    pthread_once(&xlogx_once, InitXLogXTable);
+    memset(hist, 0, sizeof(hist));
+    return LineEntropy(s, len, hist);
+}
+
+double EntropyIdealFast(size_t len)
+{
+    if (len == 0) {
+        return 0.0;
+    }
+    return log2((double) len);
+}
+
+/*
+ * Score the lines of job the way entropy.py reads them, with universal
+ * newlines: "\r\n" and a lone "\r" end a line too, and the line is
+ * scored as if it ended in "\n" instead
+ */
+static void *ScoreLines(void *arg)
+{
+    scoreJob *job = (scoreJob *) arg;
+    const unsigned char *p = job->start;
+    const unsigned char *nl, *cr, *next, *line;
+    uint32_t (*hist)[256];
+    size_t len, last_len = 0;
+    char ideal[FORMAT_DOUBLE_MAX];  /* the ideal column of the last length */
+    int ideal_len = 0;
+    char *grown;
+    unsigned char *grown_line;
+
+    hist = calloc(4, sizeof(*hist));
+    if (!hist) {
+        job->failed = 1;
+        return NULL;
+    }
+
+    while (p < job->end) {
+        nl = memchr(p, '\n', job->end - p);
+        next = nl ? nl + 1 : job->end;
+        line = p;
+        len = next - p;
+
+        cr = job->cr ? memchr(p, '\r', len) : NULL;
+        if (cr) {
+            next = (cr + 1 < job->end && cr[1] == '\n') ? cr + 2 : cr + 1;
+            len = (size_t) (cr - p) + 1;
+            if (job->line_cap < len) {
+                grown_line = realloc(job->line, len);
+                if (!grown_line) {
+                    job->failed = 1;
+                    break;
+                }
+                job->line = grown_line;
+                job->line_cap = len;
+            }
+            memcpy(job->line, p, len - 1);
+            job->line[len - 1] = '\n';
+            line = job->line;
+        }
+
+        if (job->out_cap - job->out_len < MAX_OUT_LINE) {
+            job->out_cap = 2 * job->out_cap + MAX_OUT_LINE;
+            grown = realloc(job->out, job->out_cap);
+            if (!grown) {
+                job->failed = 1;
+                break;
+            }
+            job->out = grown;
+        }
+
+        /* domain lists are mostly one length, so cache the ideal column */
+        if (len != last_len || ideal_len == 0) {
+            ideal_len = FormatDouble(ideal,
+                    (job->mode == ENTROPY_FAST)
+                    ? EntropyIdealFast(len) : EntropyIdeal(len));
+            last_len = len;
+        }
+
+        job->out_len += FormatDouble(job->out + job->out_len,
+                (job->mode == ENTROPY_FAST) ? LineEntropy(line, len, hist)
+                : LineEntropyPython(line, len, hist,
+                    job->mode == ENTROPY_PYTHON312));
+        job->out[job->out_len++] = '\t';
+        memcpy(job->out + job->out_len, ideal, ideal_len);
+        job->out_len += ideal_len;
+        job->out[job->out_len++] = '\n';
+
+        job->lines++;
+        p = next;
+    }
+
+    free(hist);
+    return NULL;
+}
+
+/*
+ * Return the start of the line following the one p is in, or end. A "\r"
+ * ends a line as well, but splitting only after a "\n" still lands on a
+ * line boundary and never between the two bytes of a "\r\n".
+ */
+static const unsigned char *NextLine(const unsigned char *p,
+        const unsigned char *end)
+{
+    const unsigned char *nl = memchr(p, '\n', end - p);
+
+    return nl ? nl + 1 : end;
+}
+
+/*
+ * Whether the len bytes at s are all ascii, in which case counting bytes
+ * is counting characters. Checked a block at a time so the compiler can
+ * vectorise the inner loop.
+ */
+static int IsAscii(const unsigned char *s, size_t len)
+{
+    unsigned char acc;
+    size_t i, block;
+
+    while (len > 0) {
+        block = (len < 4096) ? len : 4096;
+        acc = 0;
+        for (i = 0; i < block; i++) {
+            acc |= s[i];
+        }
+        if (acc & 0x80) {
+            return 0;
+        }
+        s += block;
+        len -= block;
+    }
+    return 1;
+}
+
+static int WriteAll(int fd, const char *buf, size_t len)
+{
+    ssize_t w;
+
+    while (len > 0) {
+        w = write(fd, buf, len);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += w;
+        len -= w;
+    }
+    return 0;
+}
+
+long long EntropyScoreFile(const char *in_path, int out_fd, int n_threads,
+        int mode)
+{
+    int fd;
+    struct stat st;
+    const unsigned char *map, *batch, *batch_end, *end, *split;
+    scoreJob *jobs;
+    pthread_t *threads;
+    long long lines = 0;
+    int failed = 0, saved_errno = 0;
+    int cr;
+    int i;
+
+    pthread_once(&xlogx_once, InitXLogXTable);
+
+    if (n_threads <= 0) {
+        n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (n_threads <= 0) {
+            n_threads = 1;
+        }
+    }
+
+    fd = open(in_path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    saved_errno = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = saved_errno;
+        return -1;
+    }
+    madvise((void *) map, st.st_size, MADV_SEQUENTIAL);
+    end = map + st.st_size;
+
+    /* entropy.py counts decoded characters, refuse before writing a line */
+    if (!IsAscii(map, st.st_size)) {
+        munmap((void *) map, st.st_size);
+        errno = EILSEQ;
+        return -1;
+    }
+    cr = memchr(map, '\r', st.st_size) != NULL;
+
+    jobs = calloc(n_threads, sizeof(scoreJob));
+    threads = calloc(n_threads, sizeof(pthread_t));
+    if (!jobs || !threads) {
+        saved_errno = ENOMEM;
+        failed = 1;
+    }
+
+    for (batch = map; !failed && batch < end; batch = batch_end) {
+        batch_end = (end - batch > BATCH_BYTES)
+                ? NextLine(batch + BATCH_BYTES, end) : end;
+
+        /* split the batch into roughly equal slices on line boundaries */
+        split = batch;
+        for (i = 0; i < n_threads; i++) {
+            jobs[i].start = split;
+            if (i == n_threads - 1
+                    || batch_end - split <= (batch_end - batch) / n_threads) {
+                split = batch_end;
+            } else {
+                split = NextLine(split + (batch_end - batch) / n_threads,
+                        batch_end);
+            }
+            jobs[i].end = split;
+            jobs[i].out_len = 0;
+            jobs[i].lines = 0;
+            jobs[i].mode = mode;
+            jobs[i].cr = cr;
+        }
+
+        /* the calling thread takes the first slice, and any slice that
+         * could not get a thread of its own */
+        for (i = 1; i < n_threads; i++) {
+            jobs[i].threaded = (pthread_create(&threads[i], NULL, ScoreLines,
+                        &jobs[i]) == 0);
+        }
+        ScoreLines(&jobs[0]);
+        for (i = 1; i < n_threads; i++) {
+            if (jobs[i].threaded) {
+                pthread_join(threads[i], NULL);
+            } else {
+                ScoreLines(&jobs[i]);
+            }
+        }
+
+        /* write the slices out in input order */
+        for (i = 0; i < n_threads && !failed; i++) {
+            if (jobs[i].failed) {
+                saved_errno = ENOMEM;
+                failed = 1;
+            } else if (WriteAll(out_fd, jobs[i].out, jobs[i].out_len) < 0) {
+                saved_errno = errno;
+                failed = 1;
+            }
+            lines += jobs[i].lines;
+        }
+    }
+
+    if (jobs) {
+        for (i = 0; i < n_threads; i++) {
+            free(jobs[i].out);
+            free(jobs[i].line);
+        }
+    }
+    free(jobs);
+    free(threads);
+    munmap((void *) map, st.st_size);
+
+    if (failed) {
+        errno = saved_errno;
+        return -1;
+    }
+    return lines;
+}
@@ -0,0 +1,61 @@
+/*
+ * Native Shannon entropy scoring, a drop in for the per line scoring done
+ * by entropy.py.
+ *
+ * A line is scored from a 256 bin byte histogram. By default every step
+ * of entropy.py's arithmetic is repeated in the same order, so the output
+ * text is byte for byte what entropy.py writes; python 3.12 changed how
+ * sum() adds floats, so the caller says which python it has to match.
+ * The fast variants rewrite
+ * sum(p * log2(p)) as log2(n) - sum(c * log2(c)) / n over the bin counts
+ * c so that the inner loop is a table lookup instead of a log per bin;
+ * their results differ from entropy.py in the last digit or two, and a
+ * line of one distinct byte scores 0.0 instead of -0.0.
+ */
+
+#ifndef _ENTROPY_H
+#define _ENTROPY_H
+
+#include <stddef.h>
+
+/* how EntropyScoreFile scores a line */
+#define ENTROPY_PYTHON      (0)     /* as entropy.py on python 3.11 and older */
+#define ENTROPY_PYTHON312   (1)     /* as entropy.py on python 3.12 and newer */
+#define ENTROPY_FAST        (2)     /* EntropyFast and EntropyIdealFast */
+
+/*
+ * Shannon entropy in bits of the len bytes at s, exactly as entropy.py
+ * computes it on python 3.12 and newer if compensated is non-zero, on
+ * older pythons otherwise
+ */
+double Entropy(const unsigned char *s, size_t len, int compensated);
+
+/*
+ * Ideal Shannon entropy of a string of len bytes, every byte distinct,
+ * exactly as entropy.py computes it; NaN for len 0, where entropy.py
+ * raises ZeroDivisionError
+ */
+double EntropyIdeal(size_t len);
+
+/*
+ * Lookup table versions of Entropy and EntropyIdeal, 0 for len 0
+ */
+double EntropyFast(const unsigned char *s, size_t len);
+double EntropyIdealFast(size_t len);
+
+/*
+ * Score every line of in_path as entropy.py reads it and write
+ * "<entropy>\t<ideal entropy>\n" per line to out_fd: lines end in "\n",
+ * "\r\n" or a lone "\r" and are scored with that ending as a single
+ * "\n", like python's universal newlines. The file is memory mapped and
+ * scored in batches, each batch split over n_threads threads (0 picks
+ * one per online cpu), and every line is scored as mode, one of
+ * ENTROPY_*. Returns the number of lines scored or -1 on error, with
+ * errno set; a file that is not all ascii, where entropy.py would count
+ * characters rather than bytes, fails with EILSEQ before anything is
+ * written.
+ */
+long long EntropyScoreFile(const char *in_path, int out_fd, int n_threads,
+        int mode);
+
+#endif
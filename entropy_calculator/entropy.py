@@ -1,8 +1,45 @@
 import math as math
 import argparse
+import ctypes
+import errno
+import os
+import sys
+
+# native scorer built by `make`, see entropy.h; the pure python versions
+# below are used when it has not been built
+try:
+        _native = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libentropy.so'), use_errno=True)
+        _native.Entropy.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_int]
+        _native.Entropy.restype = ctypes.c_double
+        _native.EntropyIdeal.argtypes = [ctypes.c_size_t]
+        _native.EntropyIdeal.restype = ctypes.c_double
+        _native.EntropyScoreFile.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_int]
+        _native.EntropyScoreFile.restype = ctypes.c_longlong
+except OSError:
+        _native = None
+
+# sum() of floats adds left to right up to python 3.11 and compensates for
+# rounding errors from 3.12 on; the native scorer has to do the same
+_compensated = sys.version_info >= (3, 12)
+# ENTROPY_PYTHON and ENTROPY_PYTHON312 in entropy.h
+_mode = 1 if _compensated else 0
+
 
 def entropy(string):
-        "Calculates the Shannon entropy of a string"
+        """Calculates the Shannon entropy of a string
+
+        The native scorer repeats this function's arithmetic step by step,
+        including the way this python's sum() adds floats, so both return
+        the same float for ascii strings; other strings are always scored
+        here."""
+
+        # the native scorer counts bytes, which only equals counting
+        # characters for ascii strings
+        if _native and string:
+                try:
+                        return _native.Entropy(string.encode('ascii'), len(string), _compensated)
+                except UnicodeEncodeError:
+                        pass
 
         # get probability of chars in string
         prob = [ float(string.count(c)) / len(string) for c in dict.fromkeys(list(string)) ]
@@ -14,7 +51,12 @@ def entropy(string):
 
 
 def entropy_ideal(length):
-        "Calculates the ideal Shannon entropy of a string with given length"
+        """Calculates the ideal Shannon entropy of a string with given length
+
+        Natively and in python alike; a length of 0 raises ZeroDivisionError."""
+
+        if _native and length:
+                return _native.EntropyIdeal(length)
 
         prob = 1.0 / length
 
@@ -26,5 +68,17 @@ if __name__ == '__main__':
     parser.add_argument('-o', '--output_file', dest='out_file', action='store', type=argparse.FileType('w'))
     args = parser.parse_args()
 
-    for line in args.in_file:
-    	args.out_file.write(str(entropy(line)) + '\t' + str(entropy_ideal(len(line))) + '\n')
+    # score the whole file natively, mmapped and across all cpus; the
+    # output is byte for byte what the loop below writes. It splits lines
+    # like the loop's universal newlines, and refuses non ascii files with
+    # EILSEQ before writing anything, which are then scored by the loop
+    scored = False
+    if _native and os.path.isfile(args.in_file.name):
+        args.out_file.flush()
+        if _native.EntropyScoreFile(args.in_file.name.encode(), args.out_file.fileno(), 0, _mode) >= 0:
+            scored = True
+        elif ctypes.get_errno() != errno.EILSEQ:
+            raise OSError(ctypes.get_errno(), 'scoring ' + args.in_file.name + ' failed')
+    if not scored:
+        for line in args.in_file:
+            args.out_file.write(str(entropy(line)) + '\t' + str(entropy_ideal(len(line))) + '\n')
@@ -0,0 +1,397 @@
+/*
+ * Shortest round trip formatting of doubles, see format_double.h
+ *
+ * The digits come from Ryu (Ulf Adams, "Ryu: fast float-to-string
+ * conversion", PLDI 2018). Every double has an interval of reals that
+ * read back as it. Ryu scales the interval's two bounds and the double
+ * itself by a power of ten using 128 bit fixed point approximations of
+ * powers of five. It then drops decimal digits while the bounds still
+ * differ, and rounds the value once at the end, so a double costs a few
+ * multiplications instead of the bignum arithmetic printf and strtod do.
+ * The power of five tables are computed exactly on first use with a
+ * small bignum.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "format_double.h"
+
+#define MANTISSA_BITS (52)
+#define EXPONENT_BIAS (1023)
+
+/* bits kept of each power of five and of its inverse */
+#define POW5_BITS (125)
+#define POW5_INV_BITS (125)
+
+/* enough for every exponent a double can have */
+#define POW5_TABLE_SIZE (326)
+#define POW5_INV_TABLE_SIZE (342)
+
+/* bignum size for the tables, 5^341 and 2^BIG_ONE fit with room to spare */
+#define BIG_LIMBS (34)
+#define BIG_ONE (960)
+
+typedef unsigned __int128 uint128_t;
+
+/* 128 bit table entries, low word first */
+static uint64_t pow5_split[POW5_TABLE_SIZE][2];
+static uint64_t pow5_inv_split[POW5_INV_TABLE_SIZE][2];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+/* ceil(log2(5^e)), or 1 for e == 0; for 0 <= e <= 3528 */
+static inline int32_t Pow5Bits(int32_t e)
+{
+    return (int32_t) (((uint32_t) e * 1217359) >> 19) + 1;
+}
+
+/* floor(log10(2^e)) for 0 <= e <= 1650 */
+static inline uint32_t Log10Pow2(int32_t e)
+{
+    return ((uint32_t) e * 78913) >> 18;
+}
+
+/* floor(log10(5^e)) for 0 <= e <= 2620 */
+static inline uint32_t Log10Pow5(int32_t e)
+{
+    return ((uint32_t) e * 732923) >> 20;
+}
+
+/* ------------------------- table setup ------------------------- */
+
+static void BigMulSmall(uint32_t *b, uint32_t m)
+{
+    uint64_t carry = 0;
+    int i;
+
+    for (i = 0; i < BIG_LIMBS; i++) {
+        carry += (uint64_t) b[i] * m;
+        b[i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+}
+
+static void BigDivSmall(uint32_t *b, uint32_t d)
+{
+    uint64_t rem = 0;
+    int i;
+
+    for (i = BIG_LIMBS - 1; i >= 0; i--) {
+        rem = (rem << 32) | b[i];
+        b[i] = (uint32_t) (rem / d);
+        rem %= d;
+    }
+}
+
+/* floor(b / 2^shift) mod 2^128 */
+static uint128_t BigBits(const uint32_t *b, int shift)
+{
+    uint128_t r = 0;
+    uint64_t word;
+    int w, limb, off;
+
+    for (w = 0; w < 4; w++) {
+        limb = (shift + 32 * w) / 32;
+        off = (shift + 32 * w) % 32;
+        word = (limb < BIG_LIMBS) ? b[limb] >> off : 0;
+        if (off && limb + 1 < BIG_LIMBS) {
+            word |= (uint64_t) b[limb + 1] << (32 - off);
+        }
+        r |= (uint128_t) (uint32_t) word << (32 * w);
+    }
+    return r;
+}
+
+/*
+ * pow5_split[i] is 5^i cut or padded to its top POW5_BITS bits,
+ * pow5_inv_split[q] is floor(2^(Pow5Bits(q) - 1 + POW5_INV_BITS) / 5^q) + 1
+ */
+static void InitTables(void)
+{
+    uint32_t b[BIG_LIMBS];
+    uint128_t v;
+    int i, shift;
+
+    memset(b, 0, sizeof(b));
+    b[0] = 1;
+    for (i = 0; i < POW5_TABLE_SIZE; i++) {
+        shift = Pow5Bits(i) - POW5_BITS;
+        v = (shift >= 0) ? BigBits(b, shift) : BigBits(b, 0) << -shift;
+        pow5_split[i][0] = (uint64_t) v;
+        pow5_split[i][1] = (uint64_t) (v >> 64);
+        BigMulSmall(b, 5);
+    }
+
+    /* floor(floor(x / 5) / 5) == floor(x / 25), so dividing 2^BIG_ONE by
+     * five q times leaves exactly floor(2^BIG_ONE / 5^q) */
+    memset(b, 0, sizeof(b));
+    b[BIG_ONE / 32] = 1u << (BIG_ONE % 32);
+    for (i = 0; i < POW5_INV_TABLE_SIZE; i++) {
+        v = BigBits(b, BIG_ONE - (Pow5Bits(i) - 1 + POW5_INV_BITS)) + 1;
+        pow5_inv_split[i][0] = (uint64_t) v;
+        pow5_inv_split[i][1] = (uint64_t) (v >> 64);
+        BigDivSmall(b, 5);
+    }
+}
+
+/* ---------------------------- digits ---------------------------- */
+
+static inline uint32_t Pow5Factor(uint64_t v)
+{
+    uint32_t count = 0;
+
+    while (v % 5 == 0) {
+        v /= 5;
+        count++;
+    }
+    return count;
+}
+
+static inline int MultipleOfPow5(uint64_t v, uint32_t p)
+{
+    return Pow5Factor(v) >= p;
+}
+
+static inline int MultipleOfPow2(uint64_t v, uint32_t p)
+{
+    return (v & ((1ull << p) - 1)) == 0;
+}
+
+/* (m * mul) >> j for a 128 bit mul and j >= 64 */
+static inline uint64_t MulShift(uint64_t m, const uint64_t *mul, int32_t j)
+{
+    uint128_t lo = (uint128_t) m * mul[0];
+    uint128_t hi = (uint128_t) m * mul[1];
+
+    return (uint64_t) (((lo >> 64) + hi) >> (j - 64));
+}
+
+/*
+ * Shortest decimal digits of the finite, non-zero double with the given
+ * raw mantissa and exponent fields: the double is *digits * 10^*exp10
+ */
+static void ShortestDigits(uint64_t ieee_mantissa, uint32_t ieee_exponent,
+        uint64_t *digits, int32_t *exp10)
+{
+    int32_t e2, e10, q, i, j, k;
+    uint64_t m2, mv, vr, vp, vm;
+    uint64_t vp_div, vm_div, vr_div;
+    uint32_t mm_shift, vr_mod;
+    int accept_bounds, vm_zeros = 0, vr_zeros = 0, round_up = 0;
+    int32_t removed = 0;
+    uint32_t last_removed = 0;
+
+    /* two more bits so the interval bounds are integers too */
+    if (ieee_exponent == 0) {
+        e2 = 1 - EXPONENT_BIAS - MANTISSA_BITS - 2;
+        m2 = ieee_mantissa;
+    } else {
+        e2 = (int32_t) ieee_exponent - EXPONENT_BIAS - MANTISSA_BITS - 2;
+        m2 = (1ull << MANTISSA_BITS) | ieee_mantissa;
+    }
+
+    /* strtod rounds half to even, so an even mantissa owns its bounds */
+    accept_bounds = (m2 & 1) == 0;
+
+    /* the interval is (4 * m2 - 1 - mm_shift, 4 * m2 + 2) * 2^e2, half as
+     * wide below a power of two */
+    mv = 4 * m2;
+    mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+    /* scale value and bounds to vr, vp and vm * 10^e10, and note whether
+     * the digits dropped by the scaling were all zero */
+    if (e2 >= 0) {
+        q = (int32_t) Log10Pow2(e2) - (e2 > 3);
+        e10 = q;
+        k = POW5_INV_BITS + Pow5Bits(q) - 1;
+        i = -e2 + q + k;
+        vr = MulShift(mv, pow5_inv_split[q], i);
+        vp = MulShift(mv + 2, pow5_inv_split[q], i);
+        vm = MulShift(mv - 1 - mm_shift, pow5_inv_split[q], i);
+        if (q <= 21) {
+            /* at most one of mv, mp and mm is a multiple of five */
+            if (mv % 5 == 0) {
+                vr_zeros = MultipleOfPow5(mv, q);
+            } else if (accept_bounds) {
+                vm_zeros = MultipleOfPow5(mv - 1 - mm_shift, q);
+            } else {
+                vp -= MultipleOfPow5(mv + 2, q);
+            }
+        }
+    } else {
+        q = (int32_t) Log10Pow5(-e2) - (-e2 > 1);
+        e10 = q + e2;
+        i = -e2 - q;
+        k = Pow5Bits(i) - POW5_BITS;
+        j = q - k;
+        vr = MulShift(mv, pow5_split[i], j);
+        vp = MulShift(mv + 2, pow5_split[i], j);
+        vm = MulShift(mv - 1 - mm_shift, pow5_split[i], j);
+        if (q <= 1) {
+            /* mv has at least two trailing zero bits, mp at least one */
+            vr_zeros = 1;
+            if (accept_bounds) {
+                vm_zeros = mm_shift == 1;
+            } else {
+                vp--;
+            }
+        } else if (q < 63) {
+            vr_zeros = MultipleOfPow2(mv, q);
+        }
+    }
+
+    /* drop digits while the bounds still differ, vr rounded at the end */
+    if (vm_zeros || vr_zeros) {
+        /* rare: the lower bound or the value may be exact, which decides
+         * whether the bound may be printed and how ties round */
+        for (;;) {
+            vp_div = vp / 10;
+            vm_div = vm / 10;
+            if (vp_div <= vm_div) {
+                break;
+            }
+            vr_div = vr / 10;
+            vr_mod = (uint32_t) (vr - 10 * vr_div);
+            vm_zeros &= vm - 10 * vm_div == 0;
+            vr_zeros &= last_removed == 0;
+            last_removed = vr_mod;
+            vr = vr_div;
+            vp = vp_div;
+            vm = vm_div;
+            removed++;
+        }
+        if (vm_zeros) {
+            for (;;) {
+                vm_div = vm / 10;
+                if (vm - 10 * vm_div != 0) {
+                    break;
+                }
+                vp_div = vp / 10;
+                vr_div = vr / 10;
+                vr_mod = (uint32_t) (vr - 10 * vr_div);
+                vr_zeros &= last_removed == 0;
+                last_removed = vr_mod;
+                vr = vr_div;
+                vp = vp_div;
+                vm = vm_div;
+                removed++;
+            }
+        }
+        /* an exact tie rounds to even */
+        if (vr_zeros && last_removed == 5 && vr % 2 == 0) {
+            last_removed = 4;
+        }
+        *digits = vr + ((vr == vm && (!accept_bounds || !vm_zeros))
+                || last_removed >= 5);
+    } else {
+        /* common: two digits at a time first, most doubles drop several */
+        vp_div = vp / 100;
+        vm_div = vm / 100;
+        if (vp_div > vm_div) {
+            vr_div = vr / 100;
+            round_up = vr - 100 * vr_div >= 50;
+            vr = vr_div;
+            vp = vp_div;
+            vm = vm_div;
+            removed += 2;
+        }
+        for (;;) {
+            vp_div = vp / 10;
+            vm_div = vm / 10;
+            if (vp_div <= vm_div) {
+                break;
+            }
+            vr_div = vr / 10;
+            round_up = vr - 10 * vr_div >= 5;
+            vr = vr_div;
+            vp = vp_div;
+            vm = vm_div;
+            removed++;
+        }
+        *digits = vr + (vr == vm || round_up);
+    }
+    *exp10 = e10 + removed;
+}
+
+/* ---------------------------- layout ---------------------------- */
+
+int FormatDouble(char *buf, double d)
+{
+    uint64_t bits, mantissa, out;
+    uint32_t exponent;
+    int32_t exp10;
+    char tmp[20];
+    const char *digits;
+    int n = 0, n_digits, decpt, i;
+
+    memcpy(&bits, &d, sizeof(bits));
+    mantissa = bits & ((1ull << MANTISSA_BITS) - 1);
+    exponent = (uint32_t) (bits >> MANTISSA_BITS) & 0x7ff;
+
+    if (exponent == 0x7ff && mantissa != 0) {
+        memcpy(buf, "nan", 4);
+        return 3;
+    }
+    if (bits >> 63) {
+        buf[n++] = '-';
+    }
+    if (exponent == 0x7ff) {
+        memcpy(buf + n, "inf", 4);
+        return n + 3;
+    }
+    if (exponent == 0 && mantissa == 0) {
+        memcpy(buf + n, "0.0", 4);
+        return n + 3;
+    }
+
+    pthread_once(&tables_once, InitTables);
+    ShortestDigits(mantissa, exponent, &out, &exp10);
+
+    i = sizeof(tmp);
+    do {
+        tmp[--i] = (char) ('0' + out % 10);
+        out /= 10;
+    } while (out);
+    digits = tmp + i;
+    n_digits = (int) sizeof(tmp) - i;
+
+    /* the value is 0.<digits> * 10^decpt */
+    decpt = n_digits + exp10;
+
+    if (decpt > -4 && decpt <= 16) {
+        if (decpt <= 0) {
+            buf[n++] = '0';
+            buf[n++] = '.';
+            memset(buf + n, '0', -decpt);
+            n += -decpt;
+            memcpy(buf + n, digits, n_digits);
+            n += n_digits;
+        } else if (decpt >= n_digits) {
+            memcpy(buf + n, digits, n_digits);
+            n += n_digits;
+            memset(buf + n, '0', decpt - n_digits);
+            n += decpt - n_digits;
+            buf[n++] = '.';
+            buf[n++] = '0';
+        } else {
+            memcpy(buf + n, digits, decpt);
+            n += decpt;
+            buf[n++] = '.';
+            memcpy(buf + n, digits + decpt, n_digits - decpt);
+            n += n_digits - decpt;
+        }
+        buf[n] = '\0';
+        return n;
+    }
+
+    buf[n++] = digits[0];
+    if (n_digits > 1) {
+        buf[n++] = '.';
+        memcpy(buf + n, digits + 1, n_digits - 1);
+        n += n_digits - 1;
+    }
+    n += sprintf(buf + n, "e%+03d", decpt - 1);
+    return n;
+}
@@ -0,0 +1,23 @@
+/*
+ * Shortest round trip formatting of doubles, the way python's repr() and
+ * str() print floats
+ */
+
+#ifndef _FORMAT_DOUBLE_H
+#define _FORMAT_DOUBLE_H
+
+/* longest string FormatDouble writes, "-2.2250738585072014e-308" and nul */
+#define FORMAT_DOUBLE_MAX (25)
+
+/*
+ * Write d to buf as python's repr() does: the fewest significant digits
+ * that read back as exactly d, the closest to d if there is a choice,
+ * positional for 1e-4 <= |d| < 1e16 and always with a decimal point
+ * there ("2.0", "-0.0", "0.0001"), in exponent form otherwise ("1e-05",
+ * "1.5e+16"), and "inf", "-inf" or "nan". buf must hold
+ * FORMAT_DOUBLE_MAX chars. Returns the number of chars written, not
+ * counting the terminating nul.
+ */
+int FormatDouble(char *buf, double d);
+
+#endif
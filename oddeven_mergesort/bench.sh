@@ -0,0 +1,14 @@
+#!/bin/sh
+#
+# Compare the sort modes on 2 to 64 locally run processes.
+#
+# usage: ./bench.sh [n]
+
+N=${1:-4000000}
+MPIRUN=${MPIRUN:-mpirun --oversubscribe}
+
+for np in 2 4 8 16 32 64; do
+    for mode in oddeven sample bitonic; do
+        $MPIRUN -np $np ./oddeven_mergesort -a $mode $N
+    done
+done
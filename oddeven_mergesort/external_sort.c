@@ -0,0 +1,398 @@
+/*
+ * Out-of-core sort of binary files of int32 or int64 keys, see
+ * external_sort.h for an overview.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mpi.h>
+
+#include "external_sort.h"
+
+/* size of the output buffer of the merge, flushed with a single write */
+#define WRITE_BUF_BYTES (8 << 20)
+
+/*
+ * Write all of buf at offset, or at the current position when offset is
+ * negative, retrying on short writes
+ */
+static int WriteAll(int fd, const void *buf, size_t len, off_t offset)
+{
+    const char *p = (const char *) buf;
+    ssize_t w;
+
+    while (len > 0) {
+        w = (offset < 0) ? write(fd, p, len) : pwrite(fd, p, len, offset);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += w;
+        len -= w;
+        if (offset >= 0) {
+            offset += w;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Return 1 if path followed by suffix names the file st was taken of
+ */
+static int SameFile(const char *path, const char *suffix,
+        const struct stat *st)
+{
+    struct stat other;
+    char *full;
+    int same;
+
+    full = (char *) malloc(strlen(path) + strlen(suffix) + 1);
+    if (!full) {
+        return 0;
+    }
+    sprintf(full, "%s%s", path, suffix);
+    same = stat(full, &other) == 0 && other.st_dev == st->st_dev
+            && other.st_ino == st->st_ino;
+    free(full);
+    return same;
+}
+
+/*
+ * Combine the failure flags of every process, doubles as a barrier
+ */
+static int AnyFailed(int failed)
+{
+    int any;
+
+    MPI_Allreduce(&failed, &any, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+    return any;
+}
+
+/*
+ * errno of the lowest ranked process that failed, 0 if none did; every
+ * process gets the same answer so all of them can report the real cause
+ */
+static int FirstErrno(int failed, int saved_errno, int m_rank, int np)
+{
+    struct {
+        int rank;
+        int err;
+    } mine, first;
+
+    mine.rank = failed ? m_rank : np;
+    mine.err = (failed && saved_errno) ? saved_errno : EIO;
+    MPI_Allreduce(&mine, &first, 1, MPI_2INT, MPI_MINLOC, MPI_COMM_WORLD);
+    return (first.rank < np) ? first.err : 0;
+}
+
+/*
+ * In the loser tree, run a beats run b if it still has keys and b is
+ * exhausted or its head is not smaller
+ */
+#define BEATS(a, b) (pos[a] < end[a] \
+        && (pos[b] == end[b] || keys[pos[a]] <= keys[pos[b]]))
+
+/*
+ * Instantiate the key type specific routines:
+ *
+ * RadixSort_<name>(a, tmp, n) sorts a using tmp as scratch, with one LSD
+ * pass per byte of the key. The sign bit is flipped so that negative keys
+ * order first, and passes where every key has the same digit are skipped.
+ *
+ * MergeRuns_<name>(keys, n, run_len, out_buf, out_len, fd) merges the
+ * sorted runs of run_len keys (the last one may be shorter) with a loser
+ * tree and streams the result to fd through out_buf. tree[0] holds the
+ * current winner and tree[1..k-1] the loser of the match played at each
+ * inner node; leaf i sits at node k + i.
+ */
+#define DEFINE_KEY_FUNCS(T, UT, NAME)                                       \
+                                                                            \
+static void RadixSort_##NAME(T *a, T *tmp, size_t n)                        \
+{                                                                           \
+    const UT flip = (UT) 1 << (8 * sizeof(T) - 1);                          \
+    size_t counts[sizeof(T)][256];                                          \
+    size_t i, sum, c;                                                       \
+    unsigned int pass, d;                                                   \
+    T *src = a, *dst = tmp, *t;                                             \
+                                                                            \
+    memset(counts, 0, sizeof(counts));                                      \
+    for (i = 0; i < n; i++) {                                               \
+        UT k = (UT) a[i] ^ flip;                                            \
+        for (pass = 0; pass < sizeof(T); pass++) {                          \
+            counts[pass][(k >> (8 * pass)) & 0xff]++;                       \
+        }                                                                   \
+    }                                                                       \
+                                                                            \
+    for (pass = 0; pass < sizeof(T); pass++) {                              \
+        if (counts[pass][((UT) a[0] ^ flip) >> (8 * pass) & 0xff] == n) {   \
+            continue;                                                       \
+        }                                                                   \
+        for (d = 0, sum = 0; d < 256; d++) {                                \
+            c = counts[pass][d];                                            \
+            counts[pass][d] = sum;                                          \
+            sum += c;                                                       \
+        }                                                                   \
+        for (i = 0; i < n; i++) {                                           \
+            d = (((UT) src[i] ^ flip) >> (8 * pass)) & 0xff;                \
+            dst[counts[pass][d]++] = src[i];                                \
+        }                                                                   \
+        t = src;                                                            \
+        src = dst;                                                          \
+        dst = t;                                                            \
+    }                                                                       \
+                                                                            \
+    if (src != a) {                                                         \
+        memcpy(a, src, n * sizeof(T));                                      \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+static int MergeRuns_##NAME(const T *keys, size_t n, size_t run_len,        \
+        T *out_buf, size_t out_len, int fd)                                 \
+{                                                                           \
+    size_t k = (n + run_len - 1) / run_len;                                 \
+    size_t *pos = (size_t *) malloc(k * sizeof(size_t));                    \
+    size_t *end = (size_t *) malloc(k * sizeof(size_t));                    \
+    size_t *tree = (size_t *) malloc(k * sizeof(size_t));                   \
+    size_t i, node, winner, t, out_n;                                       \
+    int ret = 0;                                                            \
+                                                                            \
+    if (!pos || !end || !tree) {                                            \
+        ret = -1;                                                           \
+        goto out;                                                           \
+    }                                                                       \
+                                                                            \
+    for (i = 0; i < k; i++) {                                               \
+        pos[i] = i * run_len;                                               \
+        end[i] = (pos[i] + run_len < n) ? pos[i] + run_len : n;             \
+        tree[i] = k;    /* marks an inner node nobody reached yet */        \
+    }                                                                       \
+                                                                            \
+    /* build: the first leaf to reach an inner node waits there, the       \
+     * second plays it and only the winner moves further up */             \
+    for (i = 0; i < k; i++) {                                               \
+        winner = i;                                                         \
+        for (node = (k + i) / 2; node > 0; node /= 2) {                     \
+            if (tree[node] == k) {                                          \
+                tree[node] = winner;                                        \
+                break;                                                      \
+            }                                                               \
+            if (BEATS(tree[node], winner)) {                                \
+                t = tree[node];                                             \
+                tree[node] = winner;                                        \
+                winner = t;                                                 \
+            }                                                               \
+        }                                                                   \
+        if (node == 0) {                                                    \
+            tree[0] = winner;                                               \
+        }                                                                   \
+    }                                                                       \
+                                                                            \
+    out_n = 0;                                                              \
+    for (i = 0; i < n; i++) {                                               \
+        winner = tree[0];                                                   \
+        out_buf[out_n++] = keys[pos[winner]++];                             \
+        if (out_n == out_len) {                                             \
+            if (WriteAll(fd, out_buf, out_n * sizeof(T), -1) < 0) {         \
+                ret = -1;                                                   \
+                goto out;                                                   \
+            }                                                               \
+            out_n = 0;                                                      \
+        }                                                                   \
+                                                                            \
+        /* replay the matches on the path of the leaf that just moved */    \
+        for (node = (k + winner) / 2; node > 0; node /= 2) {                \
+            if (BEATS(tree[node], winner)) {                                \
+                t = tree[node];                                             \
+                tree[node] = winner;                                        \
+                winner = t;                                                 \
+            }                                                               \
+        }                                                                   \
+        tree[0] = winner;                                                   \
+    }                                                                       \
+                                                                            \
+    if (out_n > 0 && WriteAll(fd, out_buf, out_n * sizeof(T), -1) < 0) {    \
+        ret = -1;                                                           \
+    }                                                                       \
+                                                                            \
+out:                                                                        \
+    free(pos);                                                              \
+    free(end);                                                              \
+    free(tree);                                                             \
+    return ret;                                                             \
+}
+
+DEFINE_KEY_FUNCS(int32_t, uint32_t, int32)
+DEFINE_KEY_FUNCS(int64_t, uint64_t, int64)
+
+long long ExternalSort(const char *in_path, const char *out_path,
+        int elem_size, size_t mem_bytes, int m_rank, int np)
+{
+    int fd_in = -1;         /* the input file */
+    int fd_runs = -1;       /* the file the sorted runs are written to */
+    int fd_out = -1;        /* the output file when there are several runs */
+    char *runs_path = NULL;
+    struct stat st;
+    size_t n = 0;           /* the number of keys in the input */
+    size_t run_len;         /* the number of keys sorted in memory at once */
+    size_t n_runs;
+    size_t r, len;
+    const char *in_map = MAP_FAILED;
+    const char *runs_map = MAP_FAILED;
+    char *buf = NULL, *tmp = NULL;
+    int failed = 0, saved_errno = 0;
+
+    if (elem_size != 4 && elem_size != 8) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    fd_in = open(in_path, O_RDONLY);
+    if (fd_in < 0 || fstat(fd_in, &st) < 0) {
+        failed = 1;
+        saved_errno = errno;
+    } else if (st.st_size % elem_size != 0) {
+        failed = 1;
+        saved_errno = EINVAL;
+    } else if (SameFile(out_path, "", &st) || SameFile(out_path, ".runs", &st)) {
+        /* the output and run files are truncated before the input is read */
+        failed = 1;
+        saved_errno = EINVAL;
+    }
+    if (AnyFailed(failed)) {
+        goto out;
+    }
+
+    /* two buffers per process, the chunk and the radix sort scratch */
+    n = st.st_size / elem_size;
+    run_len = mem_bytes / (2 * elem_size);
+    if (run_len == 0) {
+        run_len = 1;
+    }
+    n_runs = (n + run_len - 1) / run_len;
+
+    /* a single run needs no merge and is written straight to the output */
+    if (n_runs <= 1) {
+        runs_path = strdup(out_path);
+    } else {
+        runs_path = (char *) malloc(strlen(out_path) + sizeof(".runs"));
+        if (runs_path) {
+            sprintf(runs_path, "%s.runs", out_path);
+        }
+    }
+
+    if (m_rank == 0) {
+        fd_runs = open(runs_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_runs < 0 || ftruncate(fd_runs, st.st_size) < 0) {
+            failed = 1;
+            saved_errno = errno;
+        }
+    }
+    if (AnyFailed(failed)) {
+        goto out;
+    }
+    if (m_rank != 0) {
+        fd_runs = open(runs_path, O_RDWR);
+        if (fd_runs < 0) {
+            failed = 1;
+            saved_errno = errno;
+        }
+    }
+
+    /* run formation: run r is sorted by process r % np */
+    if (!failed && n > 0 && (size_t) m_rank < n_runs) {
+        len = (run_len < n) ? run_len : n;
+        in_map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd_in, 0);
+        buf = (char *) malloc(len * elem_size);
+        tmp = (char *) malloc(len * elem_size);
+        if (in_map == MAP_FAILED || !buf || !tmp) {
+            failed = 1;
+            saved_errno = errno;
+        } else {
+            madvise((void *) in_map, st.st_size, MADV_SEQUENTIAL);
+        }
+
+        for (r = m_rank; !failed && r < n_runs; r += np) {
+            len = (r * run_len + run_len < n) ? run_len : n - r * run_len;
+            memcpy(buf, in_map + r * run_len * elem_size, len * elem_size);
+
+            if (elem_size == 4) {
+                RadixSort_int32((int32_t *) buf, (int32_t *) tmp, len);
+            } else {
+                RadixSort_int64((int64_t *) buf, (int64_t *) tmp, len);
+            }
+
+            if (WriteAll(fd_runs, buf, len * elem_size,
+                        (off_t) (r * run_len * elem_size)) < 0) {
+                failed = 1;
+                saved_errno = errno;
+            }
+        }
+    }
+    free(tmp);
+    tmp = NULL;
+    if (AnyFailed(failed) || n_runs <= 1) {
+        goto out;
+    }
+
+    /* rank 0 merges all runs into the output */
+    if (m_rank == 0) {
+        runs_map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd_runs, 0);
+        fd_out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        free(buf);
+        buf = (char *) malloc(WRITE_BUF_BYTES);
+        if (runs_map == MAP_FAILED || fd_out < 0 || !buf) {
+            failed = 1;
+            saved_errno = errno;
+        } else {
+            madvise((void *) runs_map, st.st_size, MADV_SEQUENTIAL);
+            if (elem_size == 4) {
+                failed = MergeRuns_int32((const int32_t *) runs_map, n,
+                        run_len, (int32_t *) buf, WRITE_BUF_BYTES / 4, fd_out);
+            } else {
+                failed = MergeRuns_int64((const int64_t *) runs_map, n,
+                        run_len, (int64_t *) buf, WRITE_BUF_BYTES / 8, fd_out);
+            }
+            if (failed) {
+                saved_errno = errno;
+            }
+        }
+        unlink(runs_path);
+    }
+
+out:
+    if (in_map != MAP_FAILED) {
+        munmap((void *) in_map, st.st_size);
+    }
+    if (runs_map != MAP_FAILED) {
+        munmap((void *) runs_map, st.st_size);
+    }
+    if (fd_in >= 0) {
+        close(fd_in);
+    }
+    if (fd_runs >= 0) {
+        close(fd_runs);
+    }
+    if (fd_out >= 0 && close(fd_out) < 0 && !failed) {
+        failed = 1;
+        saved_errno = errno;
+    }
+    free(buf);
+    free(tmp);
+    free(runs_path);
+
+    saved_errno = FirstErrno(failed, saved_errno, m_rank, np);
+    if (saved_errno) {
+        errno = saved_errno;
+        return -1;
+    }
+    return (long long) n;
+}
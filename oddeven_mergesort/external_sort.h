@@ -0,0 +1,26 @@
+/*
+ * Out-of-core sort of binary files of native endian int32 or int64 keys.
+ *
+ * The input is memory mapped and cut into chunks that fit in memory; the
+ * chunks are spread over the MPI processes, radix sorted and written out
+ * as sorted runs. Rank 0 then merges the runs with a loser tree into the
+ * output file using large sequential writes.
+ */
+
+#ifndef _EXTERNAL_SORT_H
+#define _EXTERNAL_SORT_H
+
+#include <stddef.h>
+
+/*
+ * Sort the elem_size (4 or 8) byte keys of in_path into out_path, using
+ * at most mem_bytes of sort buffers per process. Must be called by every
+ * process of MPI_COMM_WORLD. Returns the number of keys sorted, or -1 on
+ * every process if any of them failed, with errno set on all of them to
+ * that of the lowest ranked process that failed. Sorting a file onto
+ * itself, or onto its own run file, fails with EINVAL.
+ */
+long long ExternalSort(const char *in_path, const char *out_path,
+        int elem_size, size_t mem_bytes, int m_rank, int np);
+
+#endif
@@ -1,56 +1,274 @@
 /*
+ * Parallel sort of random integers distributed across MPI processes.
  *
+ * Three algorithms are available, selected with -a:
+ *   oddeven  odd-even transposition sort, np rounds of block exchange
+ *   sample   sample sort, splitter selection plus a single all-to-all
+ *   bitonic  hypercube bitonic sort, log(np) * (log(np) + 1) / 2 rounds,
+ *            np must be a power of two
+ *
+ * usage: mpirun -np <np> oddeven_mergesort [-a oddeven|sample|bitonic] <n>
+ *
+ * With -f the program instead sorts a binary file of int32 or int64 keys
+ * that may be larger than memory, see external_sort.h:
+ *
+ * usage: mpirun -np <np> oddeven_mergesort -f <in> -o <out>
+ *            [-t int32|int64] [-m <MB of sort buffers per process>]
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
 #include <mpi.h>
 
+#include "external_sort.h"
+
+enum SortMode {
+    MODE_ODD_EVEN,
+    MODE_SAMPLE,
+    MODE_BITONIC
+};
+
+static const char *mode_names[] = { "oddeven", "sample", "bitonic" };
+
+static const char *usage =
+        "usage: %s [-a oddeven|sample|bitonic] <n>\n"
+        "       %s -f <in> -o <out> [-t int32|int64] [-m <MB>]\n";
+
 /*
  * Default ordering function for the sort function
  */
 int IncOrder(const void *e1, const void *e2);
 
 /*
- * 
+ * Merge the sorted blocks elems and relems, both n_local long, keeping
+ * either the n_local smallest or the n_local largest elements. Nothing is
+ * copied: the result is merged into w_space, or when the blocks do not
+ * overlap it is elems or relems untouched; the buffer holding it is
+ * returned.
  */
-int CompareSplit(int n_local, int *elems, int *relems,
+int *CompareSplit(int n_local, int *elems, int *relems,
         int *w_space, int keep_small);
 
+/*
+ * Swap buffer pointers so that *elems holds the result of CompareSplit
+ */
+void KeepResult(int *result, int **elems, int **relems, int **w_space);
+
+/*
+ * Odd-even transposition sort over blocks of n_local elements; the three
+ * buffers are rotated as the sort goes, *elems holds the result
+ */
+int OddEvenSort(int n_local, int **elems, int **relems, int **w_space,
+        int m_rank, int np);
+
+/*
+ * Hypercube bitonic sort over blocks of n_local elements, np must be a
+ * power of two
+ */
+int BitonicSort(int n_local, int **elems, int **relems, int **w_space,
+        int m_rank, int np);
+
+/*
+ * Sample sort, redistributes the elements so every process ends up with
+ * a sorted, variable sized slice; elems and n_local are replaced
+ */
+int SampleSort(int **elems, int *n_local, int m_rank, int np);
+
+/*
+ * Check that the elements are globally sorted and that none were lost,
+ * returns 1 on rank 0 if everything checks out
+ */
+int VerifySort(int n_local, int *elems, long long checksum, int n,
+        int m_rank, int np);
+
 int main(int argc, char *argv[])
 {
     int n;          /* the total number of elements to be sorted */
     int np;         /* the total number of processes */
     int m_rank;     /* the rank of the calling process */
     int n_local;    /* the number of local elements */
+    int n_block;    /* the padded block size used by the exchange sorts */
     int *elems;     /* the array of local elements */
     int *relems;    /* the buffer of received elements */
-    int odd_rank;   /* the rank of the process during odd-phase comms */
-    int even_rank;  /* the rank of the process during even-phase comms */
     int *w_space;   /* scratch space during the compare-split op */
-    int i;
-    MPI_Status status;
+    int mode;       /* the algorithm used to sort */
+    int sorted;     /* result of the verification pass */
+    long long checksum; /* sum of the local elements before sorting */
+    double t_start, t_elapsed;
+    char *in_path = NULL;   /* the file to sort in file mode */
+    char *out_path = NULL;  /* where file mode writes the sorted keys */
+    int elem_size = 4;      /* the size of the keys in file mode */
+    long mem_mb = 256;      /* sort buffer memory per process in file mode */
+    long long n_file;
+    int opt, i;
 
     /* Initialize MPI and get system information for bookkeeping */
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &np);
     MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
 
-    n = atoi(argv[1]);
-    n_local = n / np;   /* compute num elems to be sorted locally */
+    mode = MODE_ODD_EVEN;
+    while ((opt = getopt(argc, argv, "a:f:o:t:m:")) != -1) {
+        switch (opt) {
+        case 'f':
+            in_path = optarg;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 't':
+            if (strcmp(optarg, "int32") == 0) {
+                elem_size = 4;
+                break;
+            } else if (strcmp(optarg, "int64") == 0) {
+                elem_size = 8;
+                break;
+            }
+            goto bad_usage;
+        case 'm':
+            mem_mb = atol(optarg);
+            if (mem_mb > 0) {
+                break;
+            }
+            goto bad_usage;
+        case 'a':
+            for (mode = 0; mode < 3; mode++) {
+                if (strcmp(optarg, mode_names[mode]) == 0) {
+                    break;
+                }
+            }
+            if (mode < 3) {
+                break;
+            }
+            /* fall through */
+        default:
+            goto bad_usage;
+        }
+    }
+
+    if (in_path) {
+        if (!out_path) {
+            goto bad_usage;
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        t_start = MPI_Wtime();
+        n_file = ExternalSort(in_path, out_path, elem_size,
+                (size_t) mem_mb << 20, m_rank, np);
+        t_elapsed = MPI_Wtime() - t_start;
+
+        /* errno is the first failing rank's on every rank, report it once */
+        if (n_file < 0) {
+            if (m_rank == 0) {
+                perror("external sort");
+            }
+            MPI_Finalize();
+            return 1;
+        }
+        if (m_rank == 0) {
+            printf("%-8s np=%-3d n=%-10lld time=%.6f s %.1f MB/s\n", "file",
+                    np, n_file, t_elapsed,
+                    n_file * elem_size / t_elapsed / (1 << 20));
+        }
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (optind >= argc || (n = atoi(argv[optind])) < 0) {
+        goto bad_usage;
+    }
+
+    if (mode == MODE_BITONIC && (np & (np - 1)) != 0) {
+        if (m_rank == 0) {
+            fprintf(stderr, "bitonic mode needs a power of two processes\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* the first n % np processes take one extra element so that no
+     * element is dropped */
+    n_local = n / np + (m_rank < n % np);
+
+    /* the exchange based sorts need equal blocks; pad every block up to
+     * the largest one with INT_MAX, which sorts to the tail of the last
+     * processes and is trimmed off again afterwards */
+    n_block = n / np + (n % np != 0);
 
     /* allocate memory for instance arrays */
-    elems = (int *) malloc(n_local * sizeof(int));
-    relems = (int *) malloc(n_local * sizeof(int));
-    w_space = (int *) malloc(n_local * sizeof(int));
+    elems = (int *) malloc((n_block + 1) * sizeof(int));
+    relems = (int *) malloc((n_block + 1) * sizeof(int));
+    w_space = (int *) malloc((n_block + 1) * sizeof(int));
 
     /* fill in our elements array with random elements */
     srandom(m_rank);
+    checksum = 0;
     for (i = 0; i < n_local; i++) {
         elems[i] = random();
+        checksum += elems[i];
     }
 
-    /* sort local elements using built-in quicksort routine */
-    qsort(elems, n_local, sizeof(int), IncOrder);
+    MPI_Barrier(MPI_COMM_WORLD);
+    t_start = MPI_Wtime();
+
+    if (mode == MODE_SAMPLE) {
+        SampleSort(&elems, &n_local, m_rank, np);
+    } else {
+        for (i = n_local; i < n_block; i++) {
+            elems[i] = INT_MAX;
+        }
+
+        /* sort local elements using built-in quicksort routine */
+        qsort(elems, n_block, sizeof(int), IncOrder);
+
+        if (mode == MODE_ODD_EVEN) {
+            OddEvenSort(n_block, &elems, &relems, &w_space, m_rank, np);
+        } else {
+            BitonicSort(n_block, &elems, &relems, &w_space, m_rank, np);
+        }
+
+        /* the padding is now the last n_block * np - n elements overall */
+        n_local = n - m_rank * n_block;
+        if (n_local < 0) {
+            n_local = 0;
+        } else if (n_local > n_block) {
+            n_local = n_block;
+        }
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t_elapsed = MPI_Wtime() - t_start;
+
+    sorted = VerifySort(n_local, elems, checksum, n, m_rank, np);
+    if (m_rank == 0) {
+        printf("%-8s np=%-3d n=%-10d time=%.6f s %s\n", mode_names[mode],
+                np, n, t_elapsed, sorted ? "sorted" : "NOT SORTED");
+    }
+
+    free(elems);
+    free(relems);
+    free(w_space);
+    MPI_Finalize();
+    return 0;
+
+bad_usage:
+    if (m_rank == 0) {
+        fprintf(stderr, usage, argv[0], argv[0]);
+    }
+    MPI_Finalize();
+    return 1;
+}
+
+int OddEvenSort(int n_local, int **elems, int **relems, int **w_space,
+        int m_rank, int np)
+{
+    int odd_rank;   /* the rank of the process during odd-phase comms */
+    int even_rank;  /* the rank of the process during even-phase comms */
+    int partner;
+    int i;
 
     /* determine the processes that this process communicates with during
      * the odd and even phases */
@@ -70,60 +288,314 @@ int main(int argc, char *argv[])
         even_rank = MPI_PROC_NULL;
     }
 
-    /* main loop of the algorithm */
+    /* main loop of the algorithm, np phases are needed in the worst case */
+    for (i = 0; i < np; i++) {
+        partner = (i % 2 == 1) ? odd_rank : even_rank;
+
+        /* processes at the ends sit out every other phase */
+        if (partner == MPI_PROC_NULL) {
+            continue;
+        }
+
+        MPI_Sendrecv(*elems, n_local, MPI_INT, partner, 1, *relems,
+                n_local, MPI_INT, partner, 1, MPI_COMM_WORLD,
+                MPI_STATUS_IGNORE);
+
+        KeepResult(CompareSplit(n_local, *elems, *relems, *w_space,
+                    m_rank < partner), elems, relems, w_space);
+    }
+
+    return 0;
+}
+
+int BitonicSort(int n_local, int **elems, int **relems, int **w_space,
+        int m_rank, int np)
+{
+    int d;          /* the dimension of the hypercube */
+    int partner;
+    int i, j;
+
+    for (d = 0; (1 << d) < np; d++)
+        ;
+
+    /* stage i builds bitonic sequences of 2^(i+1) blocks, each step j
+     * compare-splits across dimension j of the hypercube */
+    for (i = 0; i < d; i++) {
+        for (j = i; j >= 0; j--) {
+            partner = m_rank ^ (1 << j);
+
+            MPI_Sendrecv(*elems, n_local, MPI_INT, partner, 1, *relems,
+                    n_local, MPI_INT, partner, 1, MPI_COMM_WORLD,
+                    MPI_STATUS_IGNORE);
+
+            KeepResult(CompareSplit(n_local, *elems, *relems, *w_space,
+                        ((m_rank >> (i + 1)) & 1) == ((m_rank >> j) & 1)),
+                    elems, relems, w_space);
+        }
+    }
+
+    return 0;
+}
+
+int SampleSort(int **elems, int *n_local, int m_rank, int np)
+{
+    int *local = *elems;
+    int n = *n_local;
+    int n_samples;      /* the number of samples this process contributes */
+    int total_samples;
+    int *samples;       /* the samples gathered from every process */
+    int *sample_counts, *sample_displs;
+    int *splitters;     /* the np - 1 global bucket boundaries */
+    int *scounts, *sdispls, *rcounts, *rdispls;
+    int *rbuf, *tmp, *sorted;  /* receive buffer and its merge partner */
+    int n_recv;
+    int lo, hi, mid;
+    int i, j, k, width;
+
+    /* sort local elements using built-in quicksort routine */
+    qsort(local, n, sizeof(int), IncOrder);
+
+    /* pick up to np - 1 regularly spaced local samples */
+    n_samples = (n < np - 1) ? n : np - 1;
+    sample_counts = (int *) malloc(np * sizeof(int));
+    sample_displs = (int *) malloc(np * sizeof(int));
+    MPI_Allgather(&n_samples, 1, MPI_INT, sample_counts, 1, MPI_INT,
+            MPI_COMM_WORLD);
+
+    total_samples = 0;
+    for (i = 0; i < np; i++) {
+        sample_displs[i] = total_samples;
+        total_samples += sample_counts[i];
+    }
+
+    samples = (int *) malloc((total_samples + 1) * sizeof(int));
+    for (i = 0; i < n_samples; i++) {
+        samples[sample_displs[m_rank] + i] =
+                local[(long long) (i + 1) * n / (n_samples + 1)];
+    }
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, samples,
+            sample_counts, sample_displs, MPI_INT, MPI_COMM_WORLD);
+
+    /* every process picks the same splitters out of the sorted samples */
+    qsort(samples, total_samples, sizeof(int), IncOrder);
+    splitters = (int *) malloc(np * sizeof(int));
     for (i = 0; i < np - 1; i++) {
-        if (i % 2 == 1) {   /* odd phase */
-            MPI_Sendrecv(elems, n_local, MPI_INT, odd_rank, 1, relems,
-                    n_local, MPI_INT, odd_rank, 1, MPI_COMM_WORLD, &status);
-        } else {    /* even phase */
-            MPI_Sendrecv(elems, n_local, MPI_INT, even_rank, 1, relems,
-                    n_local, MPI_INT, even_rank, 1, MPI_COMM_WORLD, &status);
+        splitters[i] = (total_samples > 0)
+                ? samples[(long long) (i + 1) * total_samples / np] : INT_MAX;
+    }
+
+    /* bucket i holds the local elements in (splitters[i-1], splitters[i]],
+     * found by binary search since the local block is already sorted */
+    scounts = (int *) malloc(np * sizeof(int));
+    sdispls = (int *) malloc(np * sizeof(int));
+    rcounts = (int *) malloc(np * sizeof(int));
+    rdispls = (int *) malloc((np + 1) * sizeof(int));
+    j = 0;
+    for (i = 0; i < np - 1; i++) {
+        lo = j;
+        hi = n;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (local[mid] <= splitters[i]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
         }
+        sdispls[i] = j;
+        scounts[i] = lo - j;
+        j = lo;
+    }
+    sdispls[np - 1] = j;
+    scounts[np - 1] = n - j;
+
+    MPI_Alltoall(scounts, 1, MPI_INT, rcounts, 1, MPI_INT, MPI_COMM_WORLD);
 
-        CompareSplit(n_local, elems, relems, w_space,
-                m_rank < status.MPI_SOURCE);
+    n_recv = 0;
+    for (i = 0; i < np; i++) {
+        rdispls[i] = n_recv;
+        n_recv += rcounts[i];
     }
+    rdispls[np] = n_recv;
 
-    free(elems);
-    free(relems);
-    free(w_space);
-    MPI_Finalize();
+    rbuf = (int *) malloc((n_recv + 1) * sizeof(int));
+    tmp = (int *) malloc((n_recv + 1) * sizeof(int));
+    MPI_Alltoallv(local, scounts, sdispls, MPI_INT, rbuf, rcounts, rdispls,
+            MPI_INT, MPI_COMM_WORLD);
+
+    /* the np received runs are each sorted; merge them pairwise, doubling
+     * the run width every pass and ping-ponging between rbuf and tmp */
+    sorted = rbuf;
+    for (width = 1; width < np; width *= 2) {
+        for (k = 0; k < np; k += 2 * width) {
+            int a = rdispls[k];
+            int a_end = rdispls[(k + width < np) ? k + width : np];
+            int b = a_end;
+            int b_end = rdispls[(k + 2 * width < np) ? k + 2 * width : np];
+            int out = a;
+
+            while (a < a_end && b < b_end) {
+                tmp[out++] = (sorted[b] < sorted[a]) ? sorted[b++]
+                        : sorted[a++];
+            }
+            while (a < a_end) {
+                tmp[out++] = sorted[a++];
+            }
+            while (b < b_end) {
+                tmp[out++] = sorted[b++];
+            }
+        }
+        rbuf = sorted;
+        sorted = tmp;
+        tmp = rbuf;
+    }
+
+    free(tmp);
+    free(local);
+    free(samples);
+    free(sample_counts);
+    free(sample_displs);
+    free(splitters);
+    free(scounts);
+    free(sdispls);
+    free(rcounts);
+    free(rdispls);
+
+    *elems = sorted;
+    *n_local = n_recv;
+    return 0;
 }
 
-int CompareSplit(int n_local, int *elems, int *relems,
+int VerifySort(int n_local, int *elems, long long checksum, int n,
+        int m_rank, int np)
+{
+    int bounds[3];      /* has elements, first element, last element */
+    int *all_bounds = NULL;
+    long long sums[2], total[2];
+    int ok, prev, i;
+
+    ok = 1;
+    for (i = 1; i < n_local; i++) {
+        if (elems[i - 1] > elems[i]) {
+            ok = 0;
+        }
+    }
+
+    sums[0] = 0;
+    for (i = 0; i < n_local; i++) {
+        sums[0] += elems[i];
+    }
+    sums[0] -= checksum;
+    sums[1] = n_local;
+    MPI_Reduce(sums, total, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    bounds[0] = n_local > 0;
+    bounds[1] = n_local > 0 ? elems[0] : 0;
+    bounds[2] = n_local > 0 ? elems[n_local - 1] : 0;
+    if (m_rank == 0) {
+        all_bounds = (int *) malloc(3 * np * sizeof(int));
+    }
+    MPI_Gather(bounds, 3, MPI_INT, all_bounds, 3, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Reduce(m_rank == 0 ? MPI_IN_PLACE : &ok, &ok, 1, MPI_INT, MPI_LAND,
+            0, MPI_COMM_WORLD);
+
+    if (m_rank != 0) {
+        return 0;
+    }
+
+    /* the last element of each non-empty slice must not exceed the first
+     * element of the next non-empty slice */
+    prev = INT_MIN;
+    for (i = 0; i < np; i++) {
+        if (all_bounds[3 * i]) {
+            if (all_bounds[3 * i + 1] < prev) {
+                ok = 0;
+            }
+            prev = all_bounds[3 * i + 2];
+        }
+    }
+    free(all_bounds);
+
+    return ok && total[0] == 0 && total[1] == n;
+}
+
+int *CompareSplit(int n_local, int *elems, int *relems,
         int *w_space, int keep_small)
 {
     int i, j, k;
+    int a, b, take_a;
 
-    for (i = 0; i < n_local; i++) {
-        w_space[i] = elems[i];
+    if (n_local == 0) {
+        return elems;
     }
 
+    /* the blocks do not overlap, one of them is the answer as it is */
+    if (keep_small) {
+        if (elems[n_local - 1] <= relems[0]) {
+            return elems;
+        }
+        if (relems[n_local - 1] <= elems[0]) {
+            return relems;
+        }
+    } else {
+        if (elems[0] >= relems[n_local - 1]) {
+            return elems;
+        }
+        if (relems[0] >= elems[n_local - 1]) {
+            return relems;
+        }
+    }
+
+    /* i + j == k while merging, so neither index runs off its block and
+     * the loop needs no bounds checks; the select compiles to a cmov */
     if (keep_small) {   /* keep the n_local smaller elems */
         for (i = j = k = 0; k < n_local; k++) {
-            if (j == n_local || (i < n_local && w_space[i] < relems[j])) {
-                elems[k] = w_space[i++];
-            } else {
-                elems[k] = relems[j++];
-            }
+            a = elems[i];
+            b = relems[j];
+            take_a = a <= b;
+            w_space[k] = take_a ? a : b;
+            i += take_a;
+            j += !take_a;
         }
     } else {    /* keep the n_local larger elems */
         for (i = j = k = n_local - 1; k >= 0; k--) {
-            if (j == 0 || (i >= 0 && w_space[i] >= relems[j])) {
-                elems[k] = w_space[i--];
-            } else {
-                elems[k] = relems[j--];
-            }
+            a = elems[i];
+            b = relems[j];
+            take_a = a >= b;
+            w_space[k] = take_a ? a : b;
+            i -= take_a;
+            j -= !take_a;
         }
     }
 
-    return 0;
+    return w_space;
 }
 
 /*
- *
+ * Make *elems the buffer that holds the result of a compare-split by
+ * swapping pointers with the buffer it landed in
+ */
+void KeepResult(int *result, int **elems, int **relems, int **w_space)
+{
+    int *tmp = *elems;
+
+    if (result == *w_space) {
+        *elems = *w_space;
+        *w_space = tmp;
+    } else if (result == *relems) {
+        *elems = *relems;
+        *relems = tmp;
+    }
+}
+
+/*
+ * Compare rather than subtract; the difference only fits in an int for
+ * non-negative values like random() returns, not for any pair of ints
  */
 int IncOrder(const void *e1, const void *e2)
 {
-    return (*((int *)e1) - *((int *)e2));
+    int a = *((const int *)e1);
+    int b = *((const int *)e2);
+
+    return (a > b) - (a < b);
 }